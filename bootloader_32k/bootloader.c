@@ -23,48 +23,170 @@
 #include "version.h"
 #include "usb_cmds.h"
 #include "flash.h"
+#include "timer.h"
 #include "config.h"
 
 // Place all code and constants in this file in the segment "BOOTLOADER":
 #pragma userclass (code = BOOTLOADER)
 #pragma userclass (const = BOOTLOADER)
 
-extern bool packet_received;
+extern bit packet_received;
 
 extern xdata volatile uint8_t in1buf[];
 extern xdata volatile uint8_t out1buf[];
+extern xdata volatile uint8_t pagebuf[];
 extern xdata volatile uint8_t in1bc;
+extern xdata volatile uint8_t in1cs;
+extern xdata volatile uint8_t out1bc;
 extern xdata volatile uint8_t usbcs;
 
 static xdata uint8_t rdismb _at_ 0x0023;                // Readback Disable byte in InfoPage
+static xdata uint16_t warm_boot[2] _at_ WARM_BOOT_ADDR; // WARM_BOOT_MAGIC and ~WARM_BOOT_MAGIC after CMD_RESET
 
-static bool page_write;
+// Commands are copied from out1buf to rx1buf, and page data to its block in
+// pagebuf, so out1buf is given back to the USB controller before the packet
+// is handled. The longest command, CMD_FLASH_RANGE_CRC, is 5 bytes. See
+// config.h for the memory map:
+#define RX1BUF_SIZE 5
+static uint8_t rx1buf[RX1BUF_SIZE];
+
+// Protocol flags are kept in the bit addressable area:
+static bit page_write;
+static bit page_stream;                                 // page_write was started by CMD_FLASH_WRITE_STREAM
+static bit reset_pending;                               // CMD_RESET is acked, reset when it has been read
+static bit write_failed;                                // A written byte did not read back in this stream
 static uint16_t nblock;                                 // Holds the number of the current USB_EP1_SIZE bytes block
-static uint8_t nblocks;                                 // Holds number of the blocks programmed
+static uint16_t nblocks;                                // Holds number of the blocks left to program
+static uint8_t rx1count;                                // Number of bytes in the last packet received
+static uint16_t write_fail_addr;                        // Address of the first byte that did not read back
+static uint16_t reset_ms;                               // timer_ms() when CMD_RESET was acked
+
+static void range_crc32(uint16_t a, uint16_t n);
+
+// CRC-32 (polynomial 0xedb88320, reflected) of a nibble, so the table is
+// small enough for the XDATA image. Each entry is stored little endian and
+// the CRC is updated one byte at a time, without long arithmetic (see
+// config.h):
+static const uint8_t code crc32_nibble[16][4] =
+{
+    { 0x00, 0x00, 0x00, 0x00 }, { 0x64, 0x10, 0xB7, 0x1D }, { 0xC8, 0x20, 0x6E, 0x3B }, { 0xAC, 0x30, 0xD9, 0x26 },
+    { 0x90, 0x41, 0xDC, 0x76 }, { 0xF4, 0x51, 0x6B, 0x6B }, { 0x58, 0x61, 0xB2, 0x4D }, { 0x3C, 0x71, 0x05, 0x50 },
+    { 0x20, 0x83, 0xB8, 0xED }, { 0x44, 0x93, 0x0F, 0xF0 }, { 0xE8, 0xA3, 0xD6, 0xD6 }, { 0x8C, 0xB3, 0x61, 0xCB },
+    { 0xB0, 0xC2, 0x64, 0x9B }, { 0xD4, 0xD2, 0xD3, 0x86 }, { 0x78, 0xE2, 0x0A, 0xA0 }, { 0x1C, 0xF2, 0xBD, 0xBD }
+};
+static uint8_t range_crc[4];                            // CRC-32 of CMD_FLASH_RANGE_CRC, little endian
+
+// One bit per flash page, page n is bit n%8 of byte n/8. Page numbers from the
+// host are checked against NUM_FLASH_PAGES by parse_commands():
+static uint8_t page_known[NUM_FLASH_PAGES/8];           // The page has been scanned
+static uint8_t page_used[NUM_FLASH_PAGES/8];            // The page is in use, if it is known
+static uint8_t scan_page;                               // Next page to scan from the polling loop
+
+static const uint8_t code page_mask[8] = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80 };
+
+static void page_set_used(uint8_t pn, bool used)
+{
+    uint8_t m = page_mask[pn & 0x07];
+
+    page_known[pn >> 3] |= m;
+    if (used)
+        page_used[pn >> 3] |= m;
+    else
+        page_used[pn >> 3] &= ~m;
+}
+
+static bool page_in_use(uint8_t pn)
+{
+    uint8_t xdata *pb;
+    uint16_t j;
+
+    // A page is scanned the first time it is needed, or by the polling loop
+    // in bootloader() when it is idle, whichever comes first:
+    if ((page_known[pn >> 3] & page_mask[pn & 0x07]) == 0)
+    {
+        for(j=0,pb = (uint8_t xdata *)(FLASH_PAGE_SIZE * (uint16_t)pn);j<FLASH_PAGE_SIZE;j++, pb++)
+        {
+            if(*pb != 0xff)
+                break;
+        }
+        page_set_used(pn, j != FLASH_PAGE_SIZE);
+    }
+    return (page_used[pn >> 3] & page_mask[pn & 0x07]) != 0;
+}
+
+static void page_write_init(uint8_t pn)
+{
+    // The page in pagebuf only needs an erase if it sets a bit that is cleared
+    // in flash. Appending to a page or writing a serial number does not:
+    if (page_in_use(pn) && !flash_bytes_writable((uint16_t)pn * FLASH_PAGE_SIZE, pagebuf, FLASH_PAGE_SIZE))
+    {
+        flash_page_erase(pn);
+        timer_poll();
+    }
+    page_set_used(pn, true);
+}
 
-static bool idata used_flash_pages[NUM_FLASH_PAGES];    // Holds which flash pages to erase
+static uint16_t page_program(void)
+{
+    uint16_t a, ok;
 
+    // Erase, if needed, and program the page in pagebuf to page nblock / 8:
+    page_write_init(nblock >> 3);
+    a = (nblock & 0xfff8) << 6;
+    flash_bytes_write(a, pagebuf, FLASH_PAGE_SIZE);
+    //
+    // Read the page back, ok is the number of bytes that match:
+    ok = flash_bytes_compare(a, pagebuf, FLASH_PAGE_SIZE);
+    if (ok != FLASH_PAGE_SIZE && !write_failed)
+    {
+        write_failed = true;
+        write_fail_addr = a + ok;
+    }
+    return ok;
+}
 
 void parse_commands(void)
 {
-    uint8_t count = 0, tmp;
+    uint8_t count = 0, i;
+    uint16_t a, ok;
+    bool stream_done = false;
 
     if(page_write)
     {
-        // Multiply nblock with 64 to get block start address in flash:
-        flash_bytes_write(nblock << 6, out1buf, USB_EP1_SIZE);
+        // The block has been copied to pagebuf by bootloader(). A short (or
+        // zero length) packet ends the page, the rest of it is left erased:
+        if (rx1count < USB_EP1_SIZE)
+        {
+            for(a=((nblock & 0x07) << 6) + rx1count;a<FLASH_PAGE_SIZE;a++)
+                pagebuf[a] = 0xff;
+            nblocks -= 0x07 - (nblock & 0x07);
+            nblock |= 0x07;
+        }
+        // The whole page is programmed in one write session when its last
+        // block is in:
+        ok = FLASH_PAGE_SIZE;
+        if ((nblock & 0x07) == 0x07)
+        {
+            ok = page_program();
+        }
         nblock++;
-        nblocks++;
-        in1buf[0] = 0;
-        count = 1;
-        if (nblocks == (FLASH_PAGE_SIZE/USB_EP1_SIZE))
+        if (--nblocks == 0)
         {
             page_write = false;
         }
+        if (!page_stream)
+        {
+            in1buf[0] = (ok == FLASH_PAGE_SIZE) ? 0 : (0x80 | (uint8_t)(ok >> 6));
+            count = 1;
+        }
+        else
+        {
+            stream_done = !page_write;
+        }
     }
     else
     {
-        switch(out1buf[0])
+        switch(rx1buf[0])
         {
             case CMD_FIRMWARE_VERSION:
                 in1buf[0] = FW_VER_MAJOR;
@@ -73,46 +195,79 @@ void parse_commands(void)
                 break;
 
             case CMD_FLASH_ERASE_PAGE:
-                flash_page_erase(out1buf[1]);
-                used_flash_pages[out1buf[1]] = false;
-                in1buf[0] = 0;
+                // Pages outside the flash are refused with 1:
+                in1buf[0] = 1;
                 count = 1;
+                if (rx1buf[1] < NUM_FLASH_PAGES)
+                {
+                    flash_page_erase(rx1buf[1]);
+                    page_set_used(rx1buf[1], false);
+                    in1buf[0] = 0;
+                }
                 break;
 
-            case CMD_FLASH_WRITE_INIT:                  // Eight 64 bytes bulk packets <- PC follow after this command
-                if (used_flash_pages[out1buf[1]])
+            case CMD_FLASH_WRITE_INIT:          // Eight 64 bytes bulk packets <- PC follow after this command
+                in1buf[0] = 1;
+                count = 1;
+                if (rx1buf[1] < NUM_FLASH_PAGES)
                 {
-                    flash_page_erase(out1buf[1]);
+                    nblock = (uint16_t)rx1buf[1] << 3;  // Multiply page number by 8 to get block number
+                    nblocks = FLASH_PAGE_SIZE/USB_EP1_SIZE;
+                    page_write = true;
+                    page_stream = false;
+                    write_failed = false;
+                    write_fail_addr = 0;
+                    in1buf[0] = 0;
                 }
-                used_flash_pages[out1buf[1]] = 1;
-                nblock = (uint16_t)out1buf[1] << 3;     // Multiply page number by 8 to get block number
-                nblocks = 0;
-                page_write = true;
-                in1buf[0] = 0;
-                count = 1;
+                break;
+
+            case CMD_FLASH_WRITE_STREAM:        // rx1buf[2] pages of 512 bytes <- PC follow after this command
+                nblock = (uint16_t)rx1buf[1] << 3;
+                nblocks = (uint16_t)rx1buf[2] << 3;
+                page_stream = true;
+                write_failed = false;
+                write_fail_addr = 0;
+                // A range that does not fit in the flash is acked at once as
+                // failed at its first page, nothing is written:
+                if ((uint16_t)rx1buf[1] + rx1buf[2] > NUM_FLASH_PAGES)
+                {
+                    nblocks = 0;
+                    write_failed = true;
+                    write_fail_addr = (uint16_t)rx1buf[1] << 9;
+                }
+                page_write = (nblocks != 0);
+                // A stream of no pages is acknowledged at once:
+                stream_done = !page_write;
                 break;
 
             case CMD_FLASH_READ:
                 // Read one USB_EP1_SIZE bytes block from the address given
-                // by out1buf[1] << 6 and MS bit set by CMD_FLASH_SELECT_HALF
+                // by rx1buf[1] << 6 and MS bit set by CMD_FLASH_SELECT_HALF
                 // below:
-                nblock = (nblock & 0xff00) | (uint16_t)out1buf[1];
+                nblock = (nblock & 0xff00) | (uint16_t)rx1buf[1];
                 if (RDIS)
                 {
                     // RDISMB is set. Will return 0x00 for pages that are in use and 0xff
                     // for unused pages.
-                    if (used_flash_pages[nblock >> 3])
-                        tmp = 0x00;
-                    else
-                        tmp = 0xff;
+                    a = page_in_use(nblock >> 3) ? 0x00 : 0xff;
                     for(count=0;count<USB_EP1_SIZE;count++)
-                        in1buf[count] = tmp;
-                } 
+                        in1buf[count] = (uint8_t)a;
+                }
                 else
                     flash_bytes_read((uint16_t)nblock<<6, in1buf, USB_EP1_SIZE);
                 count = USB_EP1_SIZE;
                 break;
 
+            case CMD_FLASH_USED_PAGES:
+                for(i=0;i<NUM_FLASH_PAGES;i++)
+                {
+                    page_in_use(i);
+                    timer_poll();
+                }
+                for(count=0;count<NUM_FLASH_PAGES/8;count++)
+                    in1buf[count] = page_used[count];
+                break;
+
             case CMD_FLASH_SET_PROTECTED:
                 count = 1;
                 INFEN = 1;
@@ -131,59 +286,132 @@ void parse_commands(void)
             case CMD_FLASH_SELECT_HALF:
                 // When outbuf[1] = 0 program the lower half of the 32K bytes flash
                 // and when outbuf[1] = 1 program the upper part:
-                if (out1buf[1] == 1)
+                if (rx1buf[1] == 1)
                     nblock = (nblock & 0x00ff) | 0x0100;
                 else
                     nblock &= 0x00ff;
                 in1buf[0] = 0;
                 count = 1;
                 break;
+
+            case CMD_DEVICE_INFO:
+                in1buf[0] = (uint8_t)FLASH_SIZE;
+                in1buf[1] = (uint8_t)(FLASH_SIZE >> 8);
+                in1buf[2] = (uint8_t)FLASH_PAGE_SIZE;
+                in1buf[3] = (uint8_t)(FLASH_PAGE_SIZE >> 8);
+                in1buf[4] = USB_EP1_SIZE;
+                in1buf[5] = BOOTLOADER_FIRST_PAGE;
+                in1buf[6] = BOOTLOADER_PAGES;
+                in1buf[7] = RDIS;
+                in1buf[8] = (uint8_t)FEATURES;
+                in1buf[9] = (uint8_t)(FEATURES >> 8);
+                in1buf[10] = (uint8_t)(FEATURES >> 16);
+                in1buf[11] = (uint8_t)(FEATURES >> 24);
+                count = 12;
+                break;
+
+            case CMD_FLASH_RANGE_CRC:
+                // Little endian start address in rx1buf[1..2] and byte count
+                // in rx1buf[3..4], the CRC is returned little endian:
+                range_crc32(rx1buf[1] | ((uint16_t)rx1buf[2] << 8), rx1buf[3] | ((uint16_t)rx1buf[4] << 8));
+                for(count=0;count<4;count++)
+                    in1buf[count] = ~range_crc[count];
+                break;
+
             case CMD_RESET:
-                EA = 0;
-                usbcs |= 0x08;
-                // Reset MCU by activating watchdog
-                REGXH = 0;
-                REGXL = 1;
-                REGXC = 0x08;
+                // The reset is done by bootloader() when the ack has been read:
+                warm_boot[0] = WARM_BOOT_MAGIC;
+                warm_boot[1] = (uint16_t)~WARM_BOOT_MAGIC;
+                reset_pending = true;
+                reset_ms = timer_ms();
+                in1buf[0] = 0;
+                count = 1;
+                break;
+
             default:
                 break;
         }
     }
+    if (stream_done)
+    {
+        // A stream is only acknowledged once, after the last page:
+        in1buf[0] = write_failed;
+        in1buf[1] = (uint8_t)write_fail_addr;
+        in1buf[2] = (uint8_t)(write_fail_addr >> 8);
+        count = 3;
+    }
     if (count > 0)
         in1bc = count;
 }
 
-static void get_used_flash_pages(void)
-{    
-    uint8_t xdata *pb;
+static void page_state_reset(void)
+{
     uint8_t i;
-    uint16_t j;
     //
-    // Read through the whole flash to find out which flash
-    // pages that are in use. Store the result in the NUM_FLASH_PAGES
-    // sized array used_flash_pages[]:
-    for(i=0;i<NUM_FLASH_PAGES;i++)
+    // Forget the state of every page. Nothing is read from the flash here, so
+    // USB connects at once. The pages are scanned by page_in_use():
+    for(i=0;i<NUM_FLASH_PAGES/8;i++)
     {
-        used_flash_pages[i] = false;        
-        for(j=0,pb = (uint8_t xdata *)(FLASH_PAGE_SIZE * (uint16_t)i);j<FLASH_PAGE_SIZE;j++, pb++)
-        {
-            if(*pb != 0xff)
-            {
-                used_flash_pages[i] = true;
-                break;
-            }
-        }
+        page_known[i] = 0;
+    }
+    scan_page = 0;
+}
+
+static void range_crc32_nibble(uint8_t nibble)
+{
+    uint8_t code *t = crc32_nibble[(range_crc[0] ^ nibble) & 0x0f];
+
+    // crc = (crc >> 4) ^ crc32_nibble[(crc ^ nibble) & 0x0f]:
+    range_crc[0] = ((range_crc[0] >> 4) | (range_crc[1] << 4)) ^ t[0];
+    range_crc[1] = ((range_crc[1] >> 4) | (range_crc[2] << 4)) ^ t[1];
+    range_crc[2] = ((range_crc[2] >> 4) | (range_crc[3] << 4)) ^ t[2];
+    range_crc[3] = (range_crc[3] >> 4) ^ t[3];
+}
+
+static void range_crc32(uint16_t a, uint16_t n)
+{
+    uint8_t xdata *pb;
+    uint8_t b;
+
+    // A range is CRCed in chunks of at most RANGE_CRC_MAX bytes, so USB is
+    // serviced between them. RANGE_CRC_CONTINUE in n continues the CRC of
+    // the previous chunk. The range is clamped to the flash:
+    if ((n & RANGE_CRC_CONTINUE) == 0)
+        range_crc[0] = range_crc[1] = range_crc[2] = range_crc[3] = 0xff;
+    n &= ~RANGE_CRC_CONTINUE;
+    if (n > RANGE_CRC_MAX)
+        n = RANGE_CRC_MAX;
+    if (a >= FLASH_SIZE)
+        n = 0;
+    else if (n > FLASH_SIZE - a)
+        n = FLASH_SIZE - a;
+    // Under RDIS the CRC is computed over the filler CMD_FLASH_READ returns:
+    for(pb = (uint8_t xdata *)a;n!=0;n--,pb++)
+    {
+        if (RDIS)
+            b = page_in_use((uint16_t)pb >> 9) ? 0x00 : 0xff;
+        else
+            b = *pb;
+        range_crc32_nibble(b);
+        range_crc32_nibble(b >> 4);
     }
 }
 
 void bootloader(void)
 {
+    uint8_t xdata *pb;
+    uint8_t i;
+    bool warm;
+
     EA = 0;
-    get_used_flash_pages();
-    usb_init();
+    timer_init();
+    warm = (warm_boot[0] == WARM_BOOT_MAGIC && warm_boot[1] == (uint16_t)~WARM_BOOT_MAGIC);
+    warm_boot[0] = warm_boot[1] = 0;
+    usb_init(warm);
+    page_state_reset();
     CKCON = 0x02;       // See nRF24LU1p AX PAN
     nblock = 0;
-    packet_received = page_write = false;
+    packet_received = page_write = page_stream = reset_pending = false;
     //
     // Enter an infinite loop waiting checking the USB interrupt flag and
     // call the interrupt handler, usb_irq, when the flag is set. The interrupt
@@ -191,15 +419,53 @@ void bootloader(void)
     // received.     
     for(;;)
     {
+        timer_poll();
         if (USBF)
         {
             USBF = 0;
             usb_irq();
-            if(packet_received)
+        }
+        if (packet_received && (in1cs & 0x02) == 0)
+        {
+            // A host that queues several commands may not have read the
+            // previous response yet. The packet is left in out1buf until it
+            // has, so in1buf is not overwritten, and USB is still serviced.
+            // Then move the packet to its block in pagebuf, or the command to
+            // rx1buf, and give out1buf back to the USB controller at once, so
+            // the next packet is received while this one is handled:
+            rx1count = out1bc;
+            if (page_write)
             {
-                parse_commands();
-                packet_received = false;
+                pb = &pagebuf[(nblock & 0x07) << 6];
+                for(i=0;i<rx1count;i++)
+                    pb[i] = out1buf[i];
             }
+            else
+            {
+                for(i=0;i<rx1count && i<RX1BUF_SIZE;i++)
+                    rx1buf[i] = out1buf[i];
+            }
+            out1bc = 0xff;
+            parse_commands();
+            packet_received = false;
+        }
+        else if (reset_pending && ((in1cs & 0x02) == 0 || (uint16_t)(timer_ms() - reset_ms) >= RESET_ACK_TIMEOUT_MS))
+        {
+            // The application starts after the watchdog reset, with every SFR
+            // and the USB controller in their reset state:
+            EA = 0;
+            usbcs |= 0x08;
+            // Reset MCU by activating watchdog
+            REGXH = 0;
+            REGXL = 1;
+            REGXC = 0x08;
+            for(;;)
+                ;       // Nothing more to do until the reset
+        }
+        else if (!USBF && scan_page < NUM_FLASH_PAGES)
+        {
+            // Nothing to do, scan the next page:
+            page_in_use(scan_page++);
         }
     }
 }
@@ -23,5 +23,57 @@
 #define USB_EP1_SIZE        64
 #define FLASH_SIZE          (32U*1024U)
 #define NUM_FLASH_PAGES     FLASH_SIZE/FLASH_PAGE_SIZE
+// The bootloader starts with ?C_C51STARTUP at the start of its first page.
+// The linker settings (?C_C51STARTUP, the SROM range and the off-chip code
+// memory) must be moved with BOOTLOADER_PAGES. The host reads the boundary
+// with CMD_DEVICE_INFO, and assumes 4 pages for bootloaders without it:
+#define BOOTLOADER_PAGES    3
+#define BOOTLOADER_FIRST_PAGE (NUM_FLASH_PAGES - BOOTLOADER_PAGES)
+
+// Memory map of the running bootloader:
+//
+// DATA/IDATA 0x00-0xFF  Register bank 0, protocol flags as bit variables in
+//                       the bit addressable area, the page bitmaps, rx1buf
+//                       (5 bytes) and the other state in DATA, then the stack
+// XDATA 0x0000-0x7FFF   Flash, read through xdata pointers
+// XDATA 0x8000-0x86FF   CODE_BOOTLOADER, copied from flash by main()
+// XDATA 0x8700-0x87FB   CONST_BOOTLOADER, copied from flash by main()
+// XDATA 0x87FC-0x87FF   Warm boot marker, see WARM_BOOT_ADDR
+// XDATA 0xC440-0xC63F   pagebuf, in the unused EP2-EP5 buffers
+// XDATA 0xC640-0xC71F   EP1 OUT/IN and EP0 OUT/IN buffers
+// XDATA 0xC781-0xC7EF   USB controller registers
+//
+// Only the startup code, main(), srom_copy() and the C51 library are in
+// flash. The rest of the bootloader runs from its XDATA copy while the flash
+// is written, so it must not call the library: no generic pointers
+// (?C?CLDPTR and friends) and no long arithmetic (?C?ULCMP and friends).
+// Pointers are memory specific and values are at most 16 bits.
+//
+// The linker classes in boot24lu1p-f32.uvproj are bounded to these ranges,
+// and SROM, the flash copy of both classes, to C:0x7A00-C:0x7FFF next to
+// the startup code, so an image that does not fit in BOOTLOADER_PAGES fails
+// to link instead of overlapping the marker.
+
+// USB disconnect time after a power on, and after CMD_RESET, in ms. A hub
+// reports a disconnect after 2.5 us of SE0 (USB 2.0, 7.1.7.3, TDDIS) and
+// latches it in C_PORT_CONNECTION until the host has read it, so a host that
+// has already seen the disconnect before the watchdog reset needs no more
+// than a few ms to see the reconnect as a new device:
+#define USB_DISCONNECT_MS      50
+#define USB_DISCONNECT_WARM_MS 3
+
+// CMD_RESET leaves WARM_BOOT_MAGIC and its complement in the last four bytes
+// of XDATA RAM, so a random power on value matches 1 time in 2^32. They are
+// above CONST_BOOTLOADER (0x8700), which must stay below WARM_BOOT_ADDR, and
+// the startup code does not clear them. bootloader() clears them whenever it
+// has read them. If a watchdog reset does not keep the RAM, the marker is
+// not found and the full USB_DISCONNECT_MS is used:
+#define WARM_BOOT_ADDR  0x87FC
+#define WARM_BOOT_MAGIC 0x5742
+
+// CMD_RESET resets once the host has read the ack. Hosts before
+// FEATURE_RESET_ACK never read it, so the reset is also done this many ms
+// after the ack:
+#define RESET_ACK_TIMEOUT_MS    20
 
 #endif // CONFIG_H__
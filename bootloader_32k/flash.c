@@ -44,6 +44,7 @@ void flash_page_erase(uint8_t pn)
 void flash_bytes_write(uint16_t a, uint8_t xdata *p, uint16_t n)
 {
     uint8_t xdata *data pb;
+    uint8_t xdata *data ps = p;
 
     CKCON = 0x01;
     // Enable flash write operation:
@@ -51,15 +52,22 @@ void flash_bytes_write(uint16_t a, uint8_t xdata *p, uint16_t n)
     FCR = 0x55;
     WEN = 1;
     //
-    // Write the bytes directly to the flash:
+    // Write the bytes directly to the flash. A whole page is written in one
+    // session, so keep the loop short. Bytes that already hold the new value
+    // (0xff in an erased page) are skipped:
     pb = (uint8_t xdata *)a;
     while(n--)
     {
-        *pb++ = *p++;
-        //
-        // Wait for the write operation to finish:
-        while(RDYN == 1)
-            ;
+        if (*pb != *ps)
+        {
+            *pb = *ps;
+            //
+            // Wait for the write operation to finish:
+            while(RDYN == 1)
+                ;
+        }
+        pb++;
+        ps++;
     }
     WEN = 0;
     CKCON = 0x02;
@@ -88,6 +96,36 @@ void flash_byte_write(uint16_t a, uint8_t b)
     CKCON = 0x02;
 }
 
+uint16_t flash_bytes_compare(uint16_t a, uint8_t xdata *p, uint16_t n)
+{
+    uint8_t xdata *pb = (uint8_t xdata *)a;
+    uint16_t i;
+
+    for(i=0;i<n;i++)
+    {
+        if (*pb != *p)
+            break;
+        pb++;
+        p++;
+    }
+    return i;
+}
+
+bool flash_bytes_writable(uint16_t a, uint8_t xdata *p, uint16_t n)
+{
+    uint8_t xdata *pb = (uint8_t xdata *)a;
+
+    // Programming can only turn 1 bits into 0 bits:
+    while(n--)
+    {
+        if ((*pb & *p) != *p)
+            return false;
+        pb++;
+        p++;
+    }
+    return true;
+}
+
 void flash_bytes_read(uint16_t a, uint8_t xdata *p, uint16_t n)
 {
     uint8_t xdata *pb = (uint8_t xdata *)a;
@@ -39,6 +39,23 @@ void flash_bytes_write(uint16_t a, uint8_t xdata*p, uint16_t n);
   */
 void flash_byte_write(uint16_t a, uint8_t b);
 
+/** Function to compare n bytes in the Flash memory with a buffer
+ *  @param a 16 bit address in Flash
+ *  @param *p pointer to bytes to compare with
+ *  @param n number of bytes to compare
+ *  @return offset of the first byte that differs, n if all bytes are equal
+ */
+uint16_t flash_bytes_compare(uint16_t a, uint8_t xdata *p, uint16_t n);
+
+/** Function to check if n bytes can be written to the Flash memory without
+ *  erasing it first, that is if they only clear bits that are set in Flash
+ *  @param a 16 bit address in Flash
+ *  @param *p pointer to bytes to write
+ *  @param n number of bytes to check
+ *  @return true if no erase is needed
+ */
+bool flash_bytes_writable(uint16_t a, uint8_t xdata *p, uint16_t n);
+
 /** Function to read n bytes from the Flash memory
  *  @param a 16 bit address in Flash
  *  @param *p pointer to bytes to write
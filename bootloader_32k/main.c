@@ -15,10 +15,12 @@
  * This file copies the bootloader code to XDATA RAM and starts the bootlader command parser
  *
  */
+#include <Nordic\reg24lu1.h>
 #include <srom.h>
 #include <stdint.h>
 
 #include "bootloader.h"
+#include "srom_copy.h"
 #include "config.h"
 
 #if __C51__ < 810 && !defined(_lint)
@@ -38,23 +40,13 @@ SROM_MC (CONST_BOOTLOADER)
 
 void main(void)
 {
-    uint16_t i;
-
     //
     // copy bootloader functions from FLASH to RAM:
-    uint8_t code *psrc = (uint8_t code*)SROM_MC_SRC(CODE_BOOTLOADER);
-    uint8_t xdata *pdest = (uint8_t xdata*)SROM_MC_TRG(CODE_BOOTLOADER);
-    for(i=0;i<SROM_MC_LEN(CODE_BOOTLOADER);i++)
-    {
-        *pdest++ = *psrc++;
-    }
+    srom_copy((uint8_t xdata*)SROM_MC_TRG(CODE_BOOTLOADER), (uint8_t code*)SROM_MC_SRC(CODE_BOOTLOADER),
+              SROM_MC_LEN(CODE_BOOTLOADER));
     //
     // Copy bootloader constants from FLASH to RAM:
-    psrc = (uint8_t code*)SROM_MC_SRC(CONST_BOOTLOADER);
-    pdest = (uint8_t xdata*)SROM_MC_TRG(CONST_BOOTLOADER);
-    for(i=0;i<SROM_MC_LEN(CONST_BOOTLOADER);i++)
-    {
-        *pdest++ = *psrc++;
-    }
+    srom_copy((uint8_t xdata*)SROM_MC_TRG(CONST_BOOTLOADER), (uint8_t code*)SROM_MC_SRC(CONST_BOOTLOADER),
+              SROM_MC_LEN(CONST_BOOTLOADER));
     bootloader(); // Will never return
 }
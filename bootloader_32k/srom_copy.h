@@ -0,0 +1,30 @@
+/* Copyright (c) 2009 Nordic Semiconductor. All Rights Reserved.
+ *
+ * The information contained herein is confidential property of Nordic 
+ * Semiconductor ASA.Terms and conditions of usage are described in detail 
+ * in NORDIC SEMICONDUCTOR STANDARD SOFTWARE LICENSE AGREEMENT. 
+ *
+ * Licensees are granted free, non-transferable use of the information. NO
+ * WARRENTY of ANY KIND is provided. This heading must NOT be removed from
+ * the file.
+ *              
+ * $LastChangedRevision: 133 $
+ */
+
+/** @file
+ * Header file for srom_copy.a51
+ *
+ */
+#ifndef SROM_COPY_H__
+#define SROM_COPY_H__
+
+#include <stdint.h>
+
+/** Function to copy n bytes from CODE to XDATA using both data pointers
+ *  @param *dst pointer to the XDATA destination
+ *  @param *src pointer to the CODE source
+ *  @param n number of bytes to copy
+ */
+void srom_copy(uint8_t xdata *dst, uint8_t code *src, uint16_t n);
+
+#endif  // SROM_COPY_H__
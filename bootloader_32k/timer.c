@@ -0,0 +1,95 @@
+/* Copyright (c) 2009 Nordic Semiconductor. All Rights Reserved.
+ *
+ * The information contained herein is confidential property of Nordic 
+ * Semiconductor ASA.Terms and conditions of usage are described in detail 
+ * in NORDIC SEMICONDUCTOR STANDARD SOFTWARE LICENSE AGREEMENT. 
+ *
+ * Licensees are granted free, non-transferable use of the information. NO
+ * WARRENTY of ANY KIND is provided. This heading must NOT be removed from
+ * the file.
+ *              
+ * $LastChangedRevision: 133 $
+ */
+
+
+/** @file
+ * Millisecond timer
+ *
+ */
+#include <Nordic\reg24lu1.h>
+#include "timer.h"
+
+// Place all code and constants in this file in the segment "BOOTLOADER":
+#pragma userclass (code = BOOTLOADER)
+#pragma userclass (const = BOOTLOADER)
+
+// Timer0 runs free at 16 MHz / 12 (CKCON.T0M = 0), 1333.3 counts per ms, so
+// a ms is 0.025 % short. It wraps every 49 ms, so timer_poll() must be called
+// at least that often. The constant is unsigned int, so timer_poll() stays in
+// 16 bit arithmetic:
+#define T0_COUNTS_PER_MS    1333U
+
+static uint16_t ms_count;                               // ms since timer_init()
+static uint16_t t0_last;                                // Timer0 at the last timer_poll()
+static uint16_t t0_counts;                              // Timer0 counts not yet added to ms_count
+
+static uint16_t timer0_read(void)
+{
+    uint8_t h, l;
+
+    // Read TH0 again if TL0 wrapped between the two reads:
+    do
+    {
+        h = TH0;
+        l = TL0;
+    }
+    while (h != TH0);
+    return ((uint16_t)h << 8) | l;
+}
+
+void timer_init(void)
+{
+    TR0 = 0;
+    TMOD = (TMOD & 0xf0) | 0x01;    // Timer0 in 16 bit mode
+    TH0 = 0;
+    TL0 = 0;
+    ms_count = 0;
+    t0_last = 0;
+    t0_counts = 0;
+    TR0 = 1;
+}
+
+void timer_poll(void)
+{
+    uint16_t t = timer0_read(), n;
+
+    // Every count since the last poll is added, not only a whole overflow,
+    // so no time is lost between polls shorter than 49 ms:
+    n = t - t0_last;
+    t0_last = t;
+    while (n >= T0_COUNTS_PER_MS)
+    {
+        n -= T0_COUNTS_PER_MS;
+        ms_count++;
+    }
+    t0_counts += n;
+    if (t0_counts >= T0_COUNTS_PER_MS)
+    {
+        t0_counts -= T0_COUNTS_PER_MS;
+        ms_count++;
+    }
+}
+
+uint16_t timer_ms(void)
+{
+    timer_poll();
+    return ms_count;
+}
+
+void delay_ms(uint16_t ms)
+{
+    uint16_t start = ms_count;
+
+    while ((uint16_t)(ms_count - start) < ms)
+        timer_poll();
+}
@@ -0,0 +1,44 @@
+/* Copyright (c) 2009 Nordic Semiconductor. All Rights Reserved.
+ *
+ * The information contained herein is confidential property of Nordic 
+ * Semiconductor ASA.Terms and conditions of usage are described in detail 
+ * in NORDIC SEMICONDUCTOR STANDARD SOFTWARE LICENSE AGREEMENT. 
+ *
+ * Licensees are granted free, non-transferable use of the information. NO
+ * WARRENTY of ANY KIND is provided. This heading must NOT be removed from
+ * the file.
+ *              
+ * $LastChangedRevision: 133 $
+ */
+
+
+/** @file
+ * Header file for timer.c
+ *
+ */
+#ifndef TIMER_H__
+#define TIMER_H__
+
+#include <stdint.h>
+
+/** Function to start the ms timer (Timer0)
+ */
+void timer_init(void);
+
+/** Function to add the Timer0 counts since the last call to the ms counter.
+ *  Must be called at least every 49 ms, when Timer0 wraps; a longer blocking
+ *  operation loses the time above that
+ */
+void timer_poll(void);
+
+/** Function to read the ms counter
+ *  @return ms since timer_init(), wraps after 65535
+ */
+uint16_t timer_ms(void);
+
+/** Function to wait for a number of ms
+ *  @param ms number of ms to wait
+ */
+void delay_ms(uint16_t ms);
+
+#endif  // TIMER_H__
@@ -21,6 +21,7 @@
 
 #include "config.h"
 #include "usb.h"
+#include "timer.h"
 
 // Place all code and constants in this file in the segment "BOOTLOADER":
 #pragma userclass (code = BOOTLOADER)
@@ -30,6 +31,7 @@
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 
 // USB map:
+xdata volatile uint8_t pagebuf[FLASH_PAGE_SIZE]     _at_ 0xC440;   // EP2-EP5 buffers, EP2-EP5 are not used
 xdata volatile uint8_t out1buf[USB_EP1_SIZE]        _at_ 0xC640;
 xdata volatile uint8_t in1buf[USB_EP1_SIZE]         _at_ 0xC680;
 xdata volatile uint8_t out0buf[MAX_PACKET_SIZE_EP0] _at_ 0xC6C0;
@@ -66,87 +68,62 @@ xdata volatile uint8_t inisoval                     _at_ 0xC7E0;
 xdata volatile uint8_t outisoval                    _at_ 0xC7E1;
 xdata volatile uint8_t setupbuf[8]                  _at_ 0xC7E8;
 
-static uint8_t usb_bm_state;
 static uint8_t usb_current_config;
 static uint8_t usb_current_alt_interface;
 static usb_state_t usb_state;
 
 static uint8_t code * packetizer_data_ptr;
-static uint8_t packetizer_data_size;
-static uint8_t packetizer_pkt_size;
+static uint8_t packetizer_data_size;                    // Bytes left to send
+static uint8_t packetizer_pos;                          // Next byte to send
+static uint8_t packetizer_desc_len;                     // Length of the string descriptor being sent
+static bit packetizer_string;                           // packetizer_data_ptr is an ASCII string to send as UTF-16
 static uint8_t bmRequestType;
 
-bool packet_received;
+bit packet_received;
 
 static void packetizer_isr_ep0_in();
 static void usb_process_get_status();
 static void usb_process_get_descriptor();
 
-static void delay_ms(uint16_t ms)
-{
-    uint16_t i, j;
-    
-    for(i = 0; i < ms; i++ )
-    {
-        for( j = 0; j < 1403; j++)
-        {
-            _nop_();
-        }
-    }
-}
-
-void usb_init(void)
+void usb_init(bool warm)
 {
     // Setup state information
     usb_state = DEFAULT;
-    usb_bm_state = 0;
 
     // Setconfig configuration information
     usb_current_config = 0;
     usb_current_alt_interface = 0;
     
-    // Disconnect from USB-bus since we are in this routine from a power on and not a soft reset:
-
+    // Disconnect from USB-bus so the host enumerates the bootloader again.
+    // After CMD_RESET the host has already seen the disconnect, a short one
+    // is enough:
     usbcs |= 0x08;
-    delay_ms(50);
+    delay_ms(warm ? USB_DISCONNECT_WARM_MS : USB_DISCONNECT_MS);
     usbcs &= ~0x08;
 
     usbien = 0x1d;
-    in_ien = 0x01;
+    in_ien = 0x03;
     in_irq = 0x1f;
-    out_ien = 0x01;
+    out_ien = 0x03;
     out_irq = 0x1f;
 
-    // Setup the USB RAM with some OK default values:
+    // Setup the USB RAM for EP1. EP2-EP5 are never made valid, so their
+    // buffer addresses are not set and their RAM holds pagebuf:
     bout1addr = MAX_PACKET_SIZE_EP0/2;
-    bout2addr = MAX_PACKET_SIZE_EP0/2 + USB_EP1_SIZE/2;
-    bout3addr = MAX_PACKET_SIZE_EP0/2 + 2*USB_EP1_SIZE/2;
-    bout4addr = MAX_PACKET_SIZE_EP0/2 + 3*USB_EP1_SIZE/2;
-    bout5addr = MAX_PACKET_SIZE_EP0/2 + 4*USB_EP1_SIZE/2;
     binstaddr = 0xc0;
     bin1addr = MAX_PACKET_SIZE_EP0/2;
-    bin2addr = MAX_PACKET_SIZE_EP0/2 + USB_EP1_SIZE/2;
-    bin3addr = MAX_PACKET_SIZE_EP0/2 + 2*USB_EP1_SIZE/2;
-    bin4addr = MAX_PACKET_SIZE_EP0/2 + 3*USB_EP1_SIZE/2;
-    bin5addr = MAX_PACKET_SIZE_EP0/2 + 4*USB_EP1_SIZE/2;
-
-    // Set all endpoints to not valid (except EP0IN and EP0OUT)
-    inbulkval = 0x01;
-    outbulkval = 0x01;
+
+    // Set all endpoints to not valid except EP0 and EP1
+    inbulkval = 0x03;
+    outbulkval = 0x03;
     inisoval = 0x00;
     outisoval = 0x00;
-
-    in_ien |= 0x02;; 
-    inbulkval |= 0x02;
-    out_ien |= 0x02;
-    outbulkval |= 0x02;
     out1bc = 0xff;
 }
 
 static void packetizer_isr_ep0_in()
 {
-    uint8_t code* data_ptr; 
-    uint8_t size, i;
+    uint8_t size, i, b;
     // We are getting a ep0in interupt when the host send ACK and do not have any more data to send
     if(packetizer_data_size == 0)
     {
@@ -155,13 +132,23 @@ static void packetizer_isr_ep0_in()
         return;
     }
 
-    size = MIN(packetizer_data_size, packetizer_pkt_size);
+    size = MIN(packetizer_data_size, MAX_PACKET_SIZE_EP0);
 
-    // Copy data to the USB-controller buffer
-    data_ptr = packetizer_data_ptr;
-    for(i = 0; i < size;i++)
+    // Copy data to the USB-controller buffer. A string is expanded to a
+    // string descriptor: length, type and each character as UTF-16:
+    for(i = 0; i < size; i++, packetizer_pos++)
     {
-        in0buf[i] = *data_ptr++;
+        if (!packetizer_string)
+            b = packetizer_data_ptr[packetizer_pos];
+        else if (packetizer_pos == 0)
+            b = packetizer_desc_len;
+        else if (packetizer_pos == 1)
+            b = USB_DESC_STRING;
+        else if (packetizer_pos & 0x01)
+            b = 0x00;
+        else
+            b = packetizer_data_ptr[(packetizer_pos - 2) >> 1];
+        in0buf[i] = b;
     }
 
     // Tell the USB-controller how many bytes to send
@@ -169,7 +156,6 @@ static void packetizer_isr_ep0_in()
     in0bc = size;
 
     // Update the packetizer data
-    packetizer_data_ptr += size;
     packetizer_data_size -= size;
 }
 
@@ -184,14 +170,7 @@ static void usb_process_get_status()
     {
         switch(bmRequestType)
         {
-            case 0x80: // Device
-                if((usb_bm_state & USB_BM_STATE_ALLOW_REMOTE_WAKEUP ) == USB_BM_STATE_ALLOW_REMOTE_WAKEUP)
-                {
-                    in0buf[0] = 0x02;
-                }
-                in0bc = 0x02;
-                break;
-
+            case 0x80: // Device, remote wakeup is not supported
             case 0x81: // Interface
                 in0bc = 0x02;
                 break;
@@ -216,22 +195,23 @@ static void usb_process_get_status()
 }
 
 static void usb_process_get_descriptor()
-{ 
-    packetizer_pkt_size = MAX_PACKET_SIZE_EP0;
+{
+    uint8_t size;
+
+    packetizer_pos = 0;
+    packetizer_string = false;
     // Switch on descriptor type
     switch(setupbuf[3])
     {
         case USB_DESC_DEVICE:
             packetizer_data_ptr = (uint8_t*)&g_usb_dev_desc;
-            packetizer_data_size = MIN(setupbuf[6], sizeof(usb_dev_desc_t));
-            packetizer_isr_ep0_in();
+            size = sizeof(usb_dev_desc_t);
             break;
 
         case USB_DESC_CONFIGURATION:
             // For now we just support one configuration. The asked configuration is stored in LSB(wValue).
             packetizer_data_ptr = (uint8_t*)&g_usb_conf_desc;
-            packetizer_data_size = MIN(setupbuf[6], sizeof(usb_conf_desc_bootloader_t));
-            packetizer_isr_ep0_in();
+            size = sizeof(usb_conf_desc_bootloader_t);
             break;
 
         case USB_DESC_STRING:
@@ -239,37 +219,37 @@ static void usb_process_get_descriptor()
             if(setupbuf[2] == 0x00)
             {
                 packetizer_data_ptr = string_zero;
-                packetizer_data_size = MIN(setupbuf[6], sizeof(string_zero));
-                packetizer_isr_ep0_in();
+                size = sizeof(string_zero);
+            }
+            else if((setupbuf[2] - 1) < USB_STRING_DESC_COUNT)
+            {
+                packetizer_data_ptr = g_usb_string_desc[setupbuf[2] - 1];
+                for(size = 0; packetizer_data_ptr[size] != 0; size++)
+                    ;
+                size = 2 + 2*size;
+                packetizer_desc_len = size;
+                packetizer_string = true;
             }
             else
             {
-                if((setupbuf[2] - 1) < USB_STRING_DESC_COUNT)
-                {
-                    if (setupbuf[2] == 1)
-                        packetizer_data_ptr = g_usb_string_desc_1;
-                    else
-                        packetizer_data_ptr = g_usb_string_desc_2;;
-                    packetizer_data_size = MIN(setupbuf[6], packetizer_data_ptr[0]);
-                    packetizer_isr_ep0_in();
-                }
-                else
-                {
-                    USB_EP0_STALL();
-                }
+                USB_EP0_STALL();
+                return;
             }
             break;
+
         case USB_DESC_INTERFACE:
         case USB_DESC_ENDPOINT:
         case USB_DESC_DEVICE_QUAL:
         case USB_DESC_OTHER_SPEED_CONF:
         case USB_DESC_INTERFACE_POWER:
             USB_EP0_STALL();
-            break;
+            return;
         default:
             USB_EP0_HSNAK();
-            break;
+            return;
     }
+    packetizer_data_size = MIN(setupbuf[6], size);
+    packetizer_isr_ep0_in();
 }
 
 static void isr_sudav()
@@ -293,23 +273,15 @@ static void isr_sudav()
                break;
 
             case USB_REQ_GET_CONFIGURATION:
-                switch(usb_state)
+                // usb_current_config is 0 in the ADDRESSED state:
+                if(usb_state == ADDRESSED || usb_state == CONFIGURED)
                 {
-                    case ADDRESSED:
-                        in0buf[0] = 0x00;
-                        in0bc = 0x01;
-                        break;
-                    case CONFIGURED:
-                        in0buf[0] = usb_current_config;
-                        in0bc = 0x01;
-                        break;
-                    case ATTACHED:
-                    case POWERED:
-                    case SUSPENDED:
-                    case DEFAULT:
-                    default:
-                        USB_EP0_STALL();
-                        break;
+                    in0buf[0] = usb_current_config;
+                    in0bc = 0x01;
+                }
+                else
+                {
+                    USB_EP0_STALL();
                 }
                 break;
 
@@ -323,7 +295,6 @@ static void isr_sudav()
                         break;
                     case 0x01:
                         usb_state = CONFIGURED;
-                        usb_bm_state |= USB_BM_STATE_CONFIGURED;
                         usb_current_config = 0x01;
                         USB_EP0_HSNAK();
                         break;
@@ -346,21 +317,7 @@ static void isr_sudav()
                 break;
         }
     } 
-    // bmRequestType = 0 01 xxxxx : Data transfer direction: Host-to-device, Type: Class
-    else if((bmRequestType & 0x60 ) == 0x20)  // Class request
-    {
-        if(setupbuf[6] != 0 && ((bmRequestType & 0x80) == 0x00))
-        {
-            // If there is a OUT-transaction associated with the Control-Transfer-Write we call the callback
-            // when the OUT-transaction is finished. Note that this function do not handle several out transactions.
-            out0bc = 0xff;
-        }
-        else
-        {
-            USB_EP0_HSNAK();
-        }
-    } 
-    else  // Unknown request type
+    else  // Class, vendor and unknown requests are not supported
     {
         USB_EP0_STALL();
     }
@@ -376,7 +333,6 @@ void usb_irq(void)
         usb_state = DEFAULT;
         usb_current_config = 0;
         usb_current_alt_interface = 0;
-        usb_bm_state = 0;
     }
     else
     {
@@ -393,7 +349,6 @@ void usb_irq(void)
                 usbirq = 0x04;
                 packetizer_data_ptr = NULL;
                 packetizer_data_size = 0;
-                packetizer_pkt_size = 0;
                 break;
             case INT_SUSPEND:
                 usbirq = 0x08;
@@ -417,7 +372,7 @@ void usb_irq(void)
                 // Clear interrupt
                 out_irq = 0x02;     
                 packet_received = true;
-                out1bc = 0xff;
+                // out1buf is re-armed by the bootloader when the packet is copied
                 break;
             default:
                 break;
@@ -19,6 +19,7 @@
 #ifndef USB_H__
 #define USB_H__
 
+#include <stdbool.h>
 #include "usb_desc_bootloader.h"
 
 #define USB_EP0_HSNAK() do {ep0cs = 0x02; } while(0)
@@ -52,7 +53,11 @@ typedef enum
     SUSPENDED
 } usb_state_t;
 
-void usb_init(void);
+/** Function to connect to the USB bus and set up the USB controller
+ *  @param warm true if the bootloader was entered from CMD_RESET, the host has
+ *  then already seen a disconnect and a short one is used
+ */
+void usb_init(bool warm);
 void usb_irq(void);
 
 #endif  // USB_H__
@@ -21,12 +21,39 @@
 typedef enum
 {
   CMD_FIRMWARE_VERSION = 1,
-  CMD_FLASH_WRITE_INIT,         // Eigth 64 bytes bulk packets <- PC follow after this command
+  CMD_FLASH_WRITE_INIT,         // Eigth 64 bytes bulk packets <- PC follow after this command, each acked with
+                                // 0x00, the last one with 0x80 | first block that did not verify
   CMD_FLASH_READ,
   CMD_FLASH_ERASE_PAGE,
   CMD_FLASH_SET_PROTECTED,
   CMD_FLASH_SELECT_HALF,
-  CMD_RESET
+  CMD_RESET,                    // Acked, then disconnect and watchdog reset when the ack has been read
+  CMD_FLASH_WRITE_STREAM,       // 512 bytes per page <- PC follow, one ack when all pages are written:
+                                // status (0 or 1 = verify failed) and the 16 bit address of the first failure
+                                // A short packet ends a page early, the rest of it is left erased
+  CMD_FLASH_USED_PAGES,         // Bitmap of the pages in use -> PC, bit n%8 of byte n/8 for page n
+  CMD_DEVICE_INFO,              // Flash size and page size (16 bit), EP1 size, first bootloader page, number of
+                                // bootloader pages, RDIS and the FEATURE_* bits (32 bit) -> PC
+  CMD_FLASH_RANGE_CRC           // CRC-32 of up to RANGE_CRC_MAX flash bytes, 16 bit address and length -> PC
+                                // RANGE_CRC_CONTINUE in the length continues the CRC of the previous range
 } usb_command_t;
 
+// Bytes per CMD_FLASH_RANGE_CRC, longer ranges are CRCed in several:
+#define RANGE_CRC_MAX       512
+#define RANGE_CRC_CONTINUE  0x8000
+
+// Feature bits in the CMD_DEVICE_INFO response, bits 8-31 are free for
+// features to come:
+#define FEATURE_RESET           0x0001
+#define FEATURE_WRITE_STREAM    0x0002
+#define FEATURE_USED_PAGES      0x0004
+#define FEATURE_VERIFY_ON_WRITE 0x0008
+#define FEATURE_ERASE_IF_NEEDED 0x0010
+#define FEATURE_SHORT_PAGES     0x0020
+#define FEATURE_RANGE_CRC       0x0040
+#define FEATURE_RESET_ACK       0x0080
+
+// All features of this bootloader:
+#define FEATURES                0x000000ffUL
+
 #endif // USB_CMDS_H__
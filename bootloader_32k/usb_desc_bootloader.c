@@ -88,60 +88,15 @@ code usb_conf_desc_bootloader_t g_usb_conf_desc =
     },
 };
 
-#define USB_STRING_IDX_1_DESC "Nordic Semiconductor"
+// The strings are stored in ASCII and sent as UTF-16 string descriptors by
+// usb.c, which takes half the space:
+code uint8_t g_usb_string_desc_1[] = "Nordic Semiconductor";
+code uint8_t g_usb_string_desc_2[] = "nRF24LU1P-F32 BOOT LDR";
 
-code uint8_t g_usb_string_desc_1[] = 
+code uint8_t code * code g_usb_string_desc[USB_STRING_DESC_COUNT] =
 {
-    sizeof(USB_STRING_IDX_1_DESC) * 2, 0x03,
-    'N', 00,
-    'o', 00,
-    'r', 00,
-    'd', 00,
-    'i', 00,
-    'c', 00,
-    ' ', 00,
-    'S', 00,
-    'e', 00,
-    'm', 00,
-    'i', 00,
-    'c', 00,
-    'o', 00,
-    'n', 00,
-    'd', 00,
-    'u', 00,
-    'c', 00,
-    't', 00,
-    'o', 00,
-    'r', 00 
-};
-
-#define USB_STRING_IDX_2_DESC "nRF24LU1P-F32 BOOT LDR"
-
-code uint8_t g_usb_string_desc_2[] = 
-{
-    sizeof(USB_STRING_IDX_2_DESC) * 2, 0x03,
-    'n', 00,
-    'R', 00,
-    'F', 00,
-    '2', 00,
-    '4', 00,
-    'L', 00,
-    'U', 00,
-    '1', 00,
-    'P', 00,
-    '-', 00,
-    'F', 00,
-    '3', 00,
-    '2', 00,
-    ' ', 00,
-    'B', 00,
-    'O', 00,
-    'O', 00,
-    'T', 00,
-    ' ', 00,
-    'L', 00,
-    'D', 00,
-    'R', 00
+    g_usb_string_desc_1,
+    g_usb_string_desc_2
 };
 
 // This is for setting language American English (String descriptor 0 is an array of supported languages):
@@ -32,8 +32,7 @@ typedef struct
 
 extern code usb_conf_desc_bootloader_t g_usb_conf_desc;
 extern code usb_dev_desc_t g_usb_dev_desc;
-extern code uint8_t g_usb_string_desc_1[];
-extern code uint8_t g_usb_string_desc_2[];
+extern code uint8_t code * code g_usb_string_desc[USB_STRING_DESC_COUNT]; // NUL terminated ASCII strings
 extern code uint8_t string_zero[4];
 
 #endif  // USB_DESC_TEMPL_H__
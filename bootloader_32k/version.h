@@ -20,6 +20,6 @@
 #define VERSION_H__
 
 #define FW_VER_MAJOR 0x13
-#define FW_VER_MINOR 0x00
+#define FW_VER_MINOR 0x01
 
 #endif // VERSION_H__
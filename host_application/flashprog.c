@@ -9,122 +9,488 @@
  * the file.
  *
  */
-#include "usb.h"
 #include <stdio.h>
 #include <string.h>
+#include "usbio.h"
 #include "bootldr_usb_cmds.h"
 #include "flashprog.h"
 
 const int BULK_OUT_EP = 0x01;
 const int BULK_IN_EP = 0x81;
 
-static char usb_write_buf[64];
-static char usb_read_buf[64];
+static unsigned char usb_write_buf[64];
+static unsigned char usb_read_buf[64];
+static unsigned bootl_ver;
+static unsigned long features;                        // FEATURE_* bits of the bootloader
+static unsigned boot_first_page;                      // First flash page of the bootloader
+static unsigned rdis;                                 // Readback of the flash is disabled
+static unsigned char read_buf[MAX_FLASH_SIZE];
+static unsigned char page_plan[MAX_FLASH_PAGES];     // What flash_program() does with each page
 
-static void flash_page_program(usb_dev_handle *hdev, unsigned char *page_buf, int npage)
+#define PAGE_PROGRAM    0       // Erase if needed, write and verify
+#define PAGE_SKIP       1       // Blank in the file and on the device, nothing to do
+#define PAGE_ERASE      2       // Blank in the file, only erase it
+
+static int usb_command(libusb_device_handle *hdev, int len, unsigned char *resp, int resp_len, unsigned timeout)
+{
+    int wid, rid, res;
+
+    // The response read is queued together with the command in usb_write_buf,
+    // so it is already pending when the bootloader answers:
+    wid = usbio_submit(hdev, BULK_OUT_EP, usb_write_buf, len, 5000);
+    rid = usbio_submit(hdev, BULK_IN_EP, resp, resp_len, timeout);
+    res = usbio_wait(wid);
+    if (res != len)
+    {
+        usbio_wait(rid);
+        return (res < 0) ? res : LIBUSB_ERROR_IO;
+    }
+    return usbio_wait(rid);
+}
+
+static unsigned get_bootl_version(libusb_device_handle *hdev)
+{
+    usb_write_buf[0] = CMD_FIRMWARE_VERSION;
+    if (usb_command(hdev, 1, usb_read_buf, 2, 5000) != 2)
+        return 0;
+    return (usb_read_buf[0] << 8) | usb_read_buf[1];
+}
+
+int bootl_init(libusb_device_handle *hdev, unsigned *flash_size)
+{
+    unsigned i;
+
+    bootl_ver = get_bootl_version(hdev);
+    usb_write_buf[0] = CMD_DEVICE_INFO;
+    if (bootl_ver >= BOOTL_VER_DEVICE_INFO && usb_command(hdev, 1, usb_read_buf, 12, 1000) == 12)
+    {
+        // The bootloader tells its geometry and features. A flash size given
+        // on the command line must agree with it:
+        i = usb_read_buf[0] | (usb_read_buf[1] << 8);
+        if ((*flash_size != 0 && *flash_size != i) || i > MAX_FLASH_SIZE ||
+            (usb_read_buf[2] | (usb_read_buf[3] << 8)) != FLASH_PAGE_SIZE || usb_read_buf[4] != USB_EP_SIZE)
+        {
+            fprintf(stderr, "ERROR: Unexpected flash geometry, %u bytes in %u byte pages\n", i, usb_read_buf[2] | (usb_read_buf[3] << 8));
+            return 0;
+        }
+        *flash_size = i;
+        boot_first_page = usb_read_buf[5];
+        rdis = usb_read_buf[7];
+        features = usb_read_buf[8] | (usb_read_buf[9] << 8) | ((unsigned long)usb_read_buf[10] << 16) | ((unsigned long)usb_read_buf[11] << 24);
+        return 1;
+    }
+    // Older bootloaders can at most reset, and the flash size has to be
+    // given:
+    features = (bootl_ver >= BOOTL_VER_RESET) ? FEATURE_RESET : 0;
+    if (*flash_size == 0)
+    {
+        fprintf(stderr, "ERROR: The bootloader does not report its flash size, use -f\n");
+        return 0;
+    }
+    boot_first_page = *flash_size / FLASH_PAGE_SIZE - 4;
+    rdis = 0;
+    return 1;
+}
+
+static void print_write_error(unsigned addr)
+{
+    fprintf(stderr, "ERROR: The Flash contents does not match the file contents\nAddress = 0x%04X did not verify after programming\n", addr);
+}
+
+static int flash_page_program(libusb_device_handle *hdev, unsigned char *page_buf, int npage)
 {
     int i;
+
+    // Bootloaders this old re-arm EP1 OUT before a block is programmed, so
+    // each block waits for the ack to the previous one:
     usb_write_buf[0] = CMD_FLASH_WRITE_INIT;
     usb_write_buf[1] = npage;
-    usb_bulk_write(hdev, BULK_OUT_EP, usb_write_buf, 2, 5000);
-    usb_bulk_read(hdev, BULK_IN_EP, usb_read_buf, 1, 5000);
+    if (usb_command(hdev, 2, usb_read_buf, 1, 5000) != 1 || usb_read_buf[0] != 0)
+        return 0;
     for (i = 0; i < NUM_FLASH_BLOCKS; i++)
     {
         memcpy(usb_write_buf, &page_buf[i*USB_EP_SIZE], USB_EP_SIZE);
-        usb_bulk_write(hdev, BULK_OUT_EP, usb_write_buf, USB_EP_SIZE, 5000);
-        usb_bulk_read(hdev, BULK_IN_EP, usb_read_buf, 1, 5000);
+        if (usb_command(hdev, USB_EP_SIZE, usb_read_buf, 1, 5000) != 1)
+            return 0;
+        // The page is programmed when its last block arrives. An ack of
+        // 0x80 | n means block n of the page did not verify:
+        if (usb_read_buf[0] & 0x80)
+        {
+            print_write_error(npage * FLASH_PAGE_SIZE + (usb_read_buf[0] & 0x07) * USB_EP_SIZE);
+            return 0;
+        }
     }
+    return 1;
 }
 
-static void flash_program(usb_dev_handle *hdev, unsigned char *hex_buf, int startpage, int npages)
+static int stream_ack(libusb_device_handle *hdev, int aid)
+{
+    int res = usbio_wait(aid);
+
+    // Bootloaders before verify on write only send the status byte:
+    if (res < 1)
+        return 0;
+    if (usb_read_buf[0] != 0)
+    {
+        if (res == 3)
+            print_write_error(usb_read_buf[1] | (usb_read_buf[2] << 8));
+        return 0;
+    }
+    return 1;
+}
+
+static int page_length(unsigned char *page)
+{
+    int n;
+
+    // Trailing 0xff bytes are left out, the bootloader leaves them erased:
+    for (n = FLASH_PAGE_SIZE; n > 0 && page[n - 1] == 0xff; n--)
+        ;
+    // A page that is cut short must end with a short packet. Sending one
+    // more 0xff byte does that without a zero length packet:
+    if (n < FLASH_PAGE_SIZE && (n % USB_EP_SIZE) == 0)
+        n++;
+    return n;
+}
+
+static int flash_stream_program(libusb_device_handle *hdev, unsigned char *hex_buf, int startpage, int npages)
+{
+    int len = npages * FLASH_PAGE_SIZE;
+    int cid, did[MAX_FLASH_PAGES], dlen[MAX_FLASH_PAGES], ndata, aid, i, ok = 1;
+
+    // The pages follow the command and the bootloader acks once when done:
+    usb_write_buf[0] = CMD_FLASH_WRITE_STREAM;
+    usb_write_buf[1] = startpage;
+    usb_write_buf[2] = npages;
+    cid = usbio_submit(hdev, BULK_OUT_EP, usb_write_buf, 3, 5000);
+    if (!(features & FEATURE_SHORT_PAGES))
+    {
+        did[0] = usbio_submit(hdev, BULK_OUT_EP, &hex_buf[startpage * FLASH_PAGE_SIZE], len, 5000 + npages * 100);
+        dlen[0] = len;
+        ndata = 1;
+    }
+    else
+    {
+        // Each page is its own transfer, cut short after the last byte that
+        // is not 0xff. Keep at most half of the transfers in flight:
+        for (i = 0; i < npages; i++)
+        {
+            if (i >= USBIO_MAX_TRANSFERS / 2 && usbio_wait(did[i - USBIO_MAX_TRANSFERS / 2]) != dlen[i - USBIO_MAX_TRANSFERS / 2])
+                ok = 0;
+            dlen[i] = page_length(&hex_buf[(startpage + i) * FLASH_PAGE_SIZE]);
+            did[i] = usbio_submit(hdev, BULK_OUT_EP, &hex_buf[(startpage + i) * FLASH_PAGE_SIZE], dlen[i], 5000);
+        }
+        ndata = npages;
+    }
+    aid = usbio_submit(hdev, BULK_IN_EP, usb_read_buf, USB_EP_SIZE, 5000 + npages * 100);
+    if (usbio_wait(cid) != 3)
+        ok = 0;
+    for (i = (ndata > USBIO_MAX_TRANSFERS / 2) ? ndata - USBIO_MAX_TRANSFERS / 2 : 0; i < ndata; i++)
+    {
+        if (usbio_wait(did[i]) != dlen[i])
+            ok = 0;
+    }
+    if (!ok)
+    {
+        usbio_wait(aid);
+        return 0;
+    }
+    return stream_ack(hdev, aid);
+}
+
+static int flash_program_pages(libusb_device_handle *hdev, unsigned char *hex_buf, int startpage, int npages)
 {
     int i;
-    unsigned char page_buf[FLASH_PAGE_SIZE];
+
+    if (features & FEATURE_WRITE_STREAM)
+        return flash_stream_program(hdev, hex_buf, startpage, npages);
 
     for (i = startpage; i < (startpage + npages); i++)
     {
-        memcpy(page_buf, &hex_buf[i * FLASH_PAGE_SIZE], FLASH_PAGE_SIZE);
-        flash_page_program(hdev, page_buf, i);
+        if (!flash_page_program(hdev, &hex_buf[i * FLASH_PAGE_SIZE], i))
+            return 0;
     }
+    return 1;
 }
 
-static int flash_page_verify(usb_dev_handle *hdev, unsigned char *page_buf, int npage)
+static int flash_page_read(libusb_device_handle *hdev, int npage, unsigned char *buf)
 {
-    int i, nblock, n, fail_addr;
-    char fail_byte;
+    int i, nblock;
+
+    //
+    // One command at a time, older bootloaders do not wait for the host
+    // to read a response before they overwrite it with the next one:
     for (i = 0; i < NUM_FLASH_BLOCKS; i++)
     {
         nblock = npage * NUM_FLASH_BLOCKS + i;
 
         // Select upper/lower flash half:
         usb_write_buf[0] = CMD_FLASH_SELECT_HALF;
-        usb_write_buf[1] = (char)(nblock >> 8);
-        usb_bulk_write(hdev, BULK_OUT_EP, usb_write_buf, 2, 5000);
-        usb_bulk_read(hdev, BULK_IN_EP, usb_read_buf, 1, 5000);
-        
+        usb_write_buf[1] = (unsigned char)(nblock >> 8);
+        if (usb_command(hdev, 2, usb_read_buf, 1, 5000) != 1)
+            return 0;
+
         usb_write_buf[0] = CMD_FLASH_READ;
-        usb_write_buf[1] = (char)nblock;
-        usb_bulk_write(hdev, BULK_OUT_EP, usb_write_buf, 2, 5000);
-        usb_bulk_read(hdev, BULK_IN_EP, usb_read_buf, USB_EP_SIZE, 5000);
-        for (n = 0; n < USB_EP_SIZE; n++)
+        usb_write_buf[1] = (unsigned char)nblock;
+        if (usb_command(hdev, 2, &buf[i * USB_EP_SIZE], USB_EP_SIZE, 5000) != USB_EP_SIZE)
+            return 0;
+    }
+    return 1;
+}
+
+static int flash_page_verify(libusb_device_handle *hdev, unsigned char *page_buf, int npage)
+{
+    int n, fail_addr;
+    unsigned char fail_byte;
+
+    if (!flash_page_read(hdev, npage, read_buf))
+    {
+        fprintf(stderr, "ERROR: Could not read back flash page %d\n", npage);
+        return 0;
+    }
+    for (n = 0; n < FLASH_PAGE_SIZE; n++)
+    {
+        if (read_buf[n] != page_buf[n])
         {
-            if ((unsigned char)usb_read_buf[n] != page_buf[i * USB_EP_SIZE + n])
-            {
-                fail_addr = npage * FLASH_PAGE_SIZE + i * USB_EP_SIZE + n;
-                fail_byte = usb_read_buf[n];
-                fprintf(stderr, "ERROR: The Flash contents does not match the file contents\nAddress = 0x%04X, Expected 0x%02X, got 0x%02X\n", fail_addr, (unsigned)page_buf[i * USB_EP_SIZE + n], (unsigned)fail_byte);
-                return 0;
-            }
+            fail_addr = npage * FLASH_PAGE_SIZE + n;
+            fail_byte = read_buf[n];
+            fprintf(stderr, "ERROR: The Flash contents does not match the file contents\nAddress = 0x%04X, Expected 0x%02X, got 0x%02X\n", fail_addr, (unsigned)page_buf[n], (unsigned)fail_byte);
+            return 0;
         }
     }
     return 1;
 }
 
+static unsigned long crc32(const unsigned char *p, int n)
+{
+    // Same CRC-32 as the bootloader computes for CMD_FLASH_RANGE_CRC:
+    unsigned long crc = 0xffffffff;
+    int i;
+    while (n--)
+    {
+        crc ^= *p++;
+        for (i = 0; i < 8; i++)
+            crc = (crc >> 1) ^ ((crc & 1) ? 0xedb88320 : 0);
+    }
+    return ~crc & 0xffffffff;
+}
 
-static int flash_verify(usb_dev_handle *hdev, unsigned char *hex_buf, int startpage, int npages)
+static int flash_range_crc(libusb_device_handle *hdev, unsigned addr, unsigned n, int cont, unsigned long *crc)
+{
+    usb_write_buf[0] = CMD_FLASH_RANGE_CRC;
+    usb_write_buf[1] = addr & 0xff;
+    usb_write_buf[2] = addr >> 8;
+    usb_write_buf[3] = n & 0xff;
+    usb_write_buf[4] = (n >> 8) | (cont ? (RANGE_CRC_CONTINUE >> 8) : 0);
+    if (usb_command(hdev, 5, usb_read_buf, 4, 1000) != 4)
+        return 0;
+    *crc = usb_read_buf[0] | (usb_read_buf[1] << 8) | ((unsigned long)usb_read_buf[2] << 16) | ((unsigned long)usb_read_buf[3] << 24);
+    return 1;
+}
+
+static int flash_range_matches(libusb_device_handle *hdev, unsigned char *hex_buf, unsigned len)
+{
+    unsigned long crc;
+    unsigned addr, n;
+
+    // The bootloader CRCs at most RANGE_CRC_MAX bytes per command, so it
+    // keeps servicing USB. Each chunk continues the CRC of the previous one:
+    for (addr = 0; addr < len; addr += n)
+    {
+        n = (len - addr < RANGE_CRC_MAX) ? len - addr : RANGE_CRC_MAX;
+        if (!flash_range_crc(hdev, addr, n, addr != 0, &crc))
+            return 0;
+    }
+    return crc == crc32(hex_buf, len);
+}
+
+static int flash_verify_pages(libusb_device_handle *hdev, unsigned char *hex_buf, int startpage, int npages)
 {
     int i;
-    unsigned char page_buf[FLASH_PAGE_SIZE];
 
     for (i = startpage; i < (startpage + npages); i++)
     {
-        memcpy(page_buf, &hex_buf[i * FLASH_PAGE_SIZE], FLASH_PAGE_SIZE);
-        if (!flash_page_verify(hdev, page_buf, i))
+        if (!flash_page_verify(hdev, &hex_buf[i * FLASH_PAGE_SIZE], i))
+            return 0;
+    }
+    return 1;
+}
+
+static int flash_page_erase(libusb_device_handle *hdev, int npage)
+{
+    usb_write_buf[0] = CMD_FLASH_ERASE_PAGE;
+    usb_write_buf[1] = npage;
+    return usb_command(hdev, 2, usb_read_buf, 1, 5000) == 1;
+}
+
+static int flash_program(libusb_device_handle *hdev, unsigned char *hex_buf, int startpage, int npages)
+{
+    int i, n;
+
+    // Program each run of consecutive PAGE_PROGRAM pages:
+    for (i = startpage; i < (startpage + npages); i += n)
+    {
+        for (n = 1; page_plan[i] == PAGE_PROGRAM && (i + n) < (startpage + npages) && page_plan[i + n] == PAGE_PROGRAM; n++)
+            ;
+        if (page_plan[i] == PAGE_ERASE && !flash_page_erase(hdev, i))
+            return 0;
+        if (page_plan[i] == PAGE_PROGRAM && !flash_program_pages(hdev, hex_buf, i, n))
+            return 0;
+    }
+    return 1;
+}
+
+static int flash_verify(libusb_device_handle *hdev, unsigned char *hex_buf, int startpage, int npages)
+{
+    int i, n;
+
+    for (i = startpage; i < (startpage + npages); i += n)
+    {
+        for (n = 1; page_plan[i] == PAGE_PROGRAM && (i + n) < (startpage + npages) && page_plan[i + n] == PAGE_PROGRAM; n++)
+            ;
+        if (page_plan[i] == PAGE_PROGRAM && !flash_verify_pages(hdev, hex_buf, i, n))
             return 0;
     }
     return 1;
 }
 
-int flash_prog(usb_dev_handle *hdev, unsigned low_addr, unsigned high_addr,unsigned flash_size,  unsigned char *hex_buf)
+static int get_used_pages(libusb_device_handle *hdev, unsigned char *used_pages)
+{
+    usb_write_buf[0] = CMD_FLASH_USED_PAGES;
+    return usb_command(hdev, 1, used_pages, MAX_FLASH_PAGES / 8, 5000) == MAX_FLASH_PAGES / 8;
+}
+
+static void plan_unchanged_pages(libusb_device_handle *hdev, unsigned char *hex_buf, unsigned num_flash_pages)
+{
+    unsigned i, nskip = 0;
+    unsigned long crc;
+
+    // Compare the CRC-32 of each page if the bootloader has it, else read the
+    // flash back. A page is only skipped on a CRC-32 match, since verify on
+    // write does not cover the pages that are not written:
+    if (features & FEATURE_RANGE_CRC)
+    {
+        for (i = 0; i < num_flash_pages; i++)
+        {
+            if (page_plan[i] != PAGE_PROGRAM)
+                continue;
+            if (!flash_range_crc(hdev, i * FLASH_PAGE_SIZE, FLASH_PAGE_SIZE, 0, &crc))
+                return;
+            if (crc == crc32(&hex_buf[i * FLASH_PAGE_SIZE], FLASH_PAGE_SIZE))
+            {
+                page_plan[i] = PAGE_SKIP;
+                nskip++;
+            }
+        }
+    }
+    else
+    {
+        for (i = 0; i < num_flash_pages; i++)
+        {
+            if (page_plan[i] != PAGE_PROGRAM)
+                continue;
+            if (!flash_page_read(hdev, i, read_buf))
+                return;
+            if (memcmp(read_buf, &hex_buf[i * FLASH_PAGE_SIZE], FLASH_PAGE_SIZE) == 0)
+            {
+                page_plan[i] = PAGE_SKIP;
+                nskip++;
+            }
+        }
+    }
+    fprintf(stdout, "%d flash pages are unchanged\n", nskip);
+}
+
+static void plan_pages(libusb_device_handle *hdev, unsigned char *hex_buf, unsigned char *page_used, unsigned num_flash_pages, unsigned options)
+{
+    unsigned i;
+    unsigned char used_pages[MAX_FLASH_PAGES / 8];
+
+    // Without the used page map every page on the device is treated as dirty:
+    if (!(features & FEATURE_USED_PAGES) || !get_used_pages(hdev, used_pages))
+        memset(used_pages, 0xff, sizeof(used_pages));
+    // A page that is blank in the file is only erased, and only if the device
+    // has something in it:
+    for (i = 0; i < num_flash_pages; i++)
+    {
+        if (page_used[i])
+            page_plan[i] = PAGE_PROGRAM;
+        else if (used_pages[i / 8] & (1 << (i % 8)))
+            page_plan[i] = PAGE_ERASE;
+        else
+            page_plan[i] = PAGE_SKIP;
+    }
+    if (options & PROG_DIFFERENTIAL)
+        plan_unchanged_pages(hdev, hex_buf, num_flash_pages);
+}
+
+int flash_prog(libusb_device_handle *hdev, unsigned low_addr, unsigned high_addr,unsigned flash_size,  unsigned char *hex_buf,
+               unsigned char *page_used, unsigned options)
 {
     unsigned num_flash_pages = flash_size/FLASH_PAGE_SIZE;
-    fprintf(stdout, "Programming flash pages 1-%d...\n", num_flash_pages - 5);
+    unsigned len;
+    int verify;
+
     //
-    // First program and verify the flash pages above page 0 and below the bootloader
-    // (last four pages of the flash):
-    flash_program(hdev, hex_buf, 1, num_flash_pages - 5);
-    fprintf(stdout, "Verifying flash pages 1-%d...\n", num_flash_pages - 5);
-    if (flash_verify(hdev, hex_buf, 1, num_flash_pages - 5) == 0)
+    // The flash can not be read back when RDIS is set, so there is nothing to
+    // compare with:
+    if (rdis && (options & (PROG_DIFFERENTIAL | PROG_VERIFY)))
     {
+        fprintf(stderr, "Warning:Flash readback is disabled, can not compare with the device\n");
+        options &= ~(PROG_DIFFERENTIAL | PROG_VERIFY);
+    }
+    //
+    // Nothing is programmed if the device already holds the image. The
+    // bootloader pages are only compared if the file uses them:
+    if ((features & FEATURE_RANGE_CRC) && !rdis && !(options & PROG_VERIFY))
+    {
+        len = (high_addr > boot_first_page*FLASH_PAGE_SIZE) ? flash_size : boot_first_page*FLASH_PAGE_SIZE;
+        if (flash_range_matches(hdev, hex_buf, len))
+        {
+            fprintf(stdout, "Flash already matches the hex file\n");
+            return 1;
+        }
+    }
+    //
+    // A bootloader that verifies every block as it is written makes the
+    // verify pass redundant, unless a full readback is asked for:
+    verify = !(features & FEATURE_VERIFY_ON_WRITE) || (options & PROG_VERIFY);
+    plan_pages(hdev, hex_buf, page_used, num_flash_pages, options);
+    fprintf(stdout, "Programming flash pages 1-%d...\n", boot_first_page - 1);
+    //
+    // First program and verify the flash pages above page 0 and below the bootloader
+    // (the last pages of the flash):
+    if (!flash_program(hdev, hex_buf, 1, boot_first_page - 1))
         return 0;
+    if (verify)
+    {
+        fprintf(stdout, "Verifying flash pages 1-%d...\n", boot_first_page - 1);
+        if (flash_verify(hdev, hex_buf, 1, boot_first_page - 1) == 0)
+        {
+            return 0;
+        }
     }
     //
     // Then program page 0 and the pages containing the bootloader:
-    fprintf(stdout, "Programming flash page 0...\n", num_flash_pages - 5);
-    flash_program(hdev, hex_buf, 0, 1);
-    if (high_addr > (num_flash_pages - 4)*FLASH_PAGE_SIZE)
+    fprintf(stdout, "Programming flash page 0...\n", boot_first_page - 1);
+    if (!flash_program(hdev, hex_buf, 0, 1))
+        return 0;
+    if (high_addr > boot_first_page*FLASH_PAGE_SIZE)
     {
         // Only program pages containing bootloader if user program uses these pages
-        fprintf(stdout, "Programming flash pages %d-%d...\n", num_flash_pages - 4, num_flash_pages - 1);
-        flash_program(hdev, hex_buf, num_flash_pages - 4, 4);
+        fprintf(stdout, "Programming flash pages %d-%d...\n", boot_first_page, num_flash_pages - 1);
+        if (!flash_program(hdev, hex_buf, boot_first_page, num_flash_pages - boot_first_page))
+            return 0;
     }
-    fprintf(stdout, "Verifying flash page 0...\n", num_flash_pages - 5);
+    if (!verify)
+        return 1;
+    fprintf(stdout, "Verifying flash page 0...\n", boot_first_page - 1);
     if (flash_verify(hdev, hex_buf, 0, 1) == 0)
         return 0;
-    if (high_addr > (num_flash_pages - 4)*FLASH_PAGE_SIZE)
+    if (high_addr > boot_first_page*FLASH_PAGE_SIZE)
     {
-        fprintf(stdout, "Verifying flash pages %d-%d...\n", num_flash_pages - 4, num_flash_pages - 1);
-        if(flash_verify(hdev, hex_buf, num_flash_pages - 4, 4) == 0)
+        fprintf(stdout, "Verifying flash pages %d-%d...\n", boot_first_page, num_flash_pages - 1);
+        if(flash_verify(hdev, hex_buf, boot_first_page, num_flash_pages - boot_first_page) == 0)
         {
             return 0;
         }
@@ -132,20 +498,38 @@ int flash_prog(usb_dev_handle *hdev, unsigned low_addr, unsigned high_addr,unsig
     return 1;
 }
 
-void reset_bootl(usb_dev_handle *hdev)
+int flash_erase(libusb_device_handle *hdev)
+{
+    unsigned i;
+
+    //
+    // Only the application pages are erased. Page 0 holds the reset vector and
+    // the last pages hold the bootloader:
+    fprintf(stdout, "Erasing flash pages 1-%d...\n", boot_first_page - 1);
+    for (i = 1; i < boot_first_page; i++)
+    {
+        if (!flash_page_erase(hdev, i))
+            return 0;
+    }
+    return 1;
+}
+
+void reset_bootl(libusb_device_handle *hdev)
 {
     fprintf(stdout, "Resetting bootloader...\n");
-    // get bootloader firmware version
-    usb_write_buf[0] = CMD_FIRMWARE_VERSION;
-    usb_bulk_write(hdev, BULK_OUT_EP, usb_write_buf, 1, 5000);
-    usb_bulk_read(hdev, BULK_IN_EP, usb_read_buf, 2, 5000);
-    if (usb_read_buf[0]<=0x12)
+    if (!(features & FEATURE_RESET))
     {
-        fprintf(stderr, "Warning:Bootloader version is %d(<=%d),does not support auto reset!\n", usb_read_buf[0],0x12);
+        fprintf(stderr, "Warning:Bootloader version is %d(<=%d),does not support auto reset!\n", bootl_ver >> 8, 0x12);
         return;
     }
-    // reset bootloader
+    // reset bootloader, it resets when the ack has been read:
     usb_write_buf[0] = CMD_RESET;
-    usb_bulk_write(hdev, BULK_OUT_EP, usb_write_buf, 1, 5000);
+    if (features & FEATURE_RESET_ACK)
+    {
+        if (usb_command(hdev, 1, usb_read_buf, 1, 5000) != 1)
+            fprintf(stderr, "Warning:No ack to the reset\n");
+        return;
+    }
+    usbio_bulk(hdev, BULK_OUT_EP, usb_write_buf, 1, 5000);
     return;
 }
\ No newline at end of file
@@ -12,12 +12,20 @@
 #ifndef FLASH_PROG_H_
 #define FLASH_PROG_H_
 
-void reset_bootl(usb_dev_handle *hdev);
-int flash_prog(usb_dev_handle *hdev, unsigned low_addr, unsigned high_addr, unsigned flash_size, unsigned char *hex_buf);
+int bootl_init(libusb_device_handle *hdev, unsigned *flash_size);
+void reset_bootl(libusb_device_handle *hdev);
+int flash_erase(libusb_device_handle *hdev);
+int flash_prog(libusb_device_handle *hdev, unsigned low_addr, unsigned high_addr, unsigned flash_size, unsigned char *hex_buf,
+               unsigned char *page_used, unsigned options);
+
+// Options for flash_prog():
+#define PROG_DIFFERENTIAL   0x01    // Only erase and program pages that differ from the device
+#define PROG_VERIFY         0x02    // Read all programmed pages back, even if the bootloader verifies on write
 
 #define USB_EP_SIZE         64
 #define FLASH_PAGE_SIZE     512
 #define NUM_FLASH_BLOCKS    FLASH_PAGE_SIZE / USB_EP_SIZE
 #define MAX_FLASH_SIZE      32*1024
+#define MAX_FLASH_PAGES     MAX_FLASH_SIZE / FLASH_PAGE_SIZE
 
 #endif // FLASH_PROG_H_
@@ -16,7 +16,8 @@
 #include <string.h>
 #include "hexfile.h"
 
-static int read_hex_line(char *line, unsigned char *buf, unsigned bufSize, unsigned *lowAddr, unsigned *highAddr)
+static int read_hex_line(char *line, unsigned char *buf, unsigned bufSize, unsigned *lowAddr, unsigned *highAddr,
+                         unsigned char *pageUsed, unsigned pageSize)
 {
     unsigned long addr;
     unsigned nbytes, tmp, csum, i;
@@ -42,6 +43,8 @@ static int read_hex_line(char *line, unsigned char *buf, unsigned bufSize, unsig
                 if (addr < *lowAddr)
                     *lowAddr = addr;
                 buf[addr] = (unsigned char)tmp;
+                if (tmp != 0xff)
+                    pageUsed[addr / pageSize] = 1;
                 csum += tmp;
                 line = &line[2];
                 addr++;
@@ -71,7 +74,8 @@ static int read_hex_line(char *line, unsigned char *buf, unsigned bufSize, unsig
     return NO_ERR;
 }
 
-int read_hex_file(FILE *fp, int crc, unsigned char *buf, unsigned buf_size, unsigned *low_addr, unsigned *high_addr)
+int read_hex_file(FILE *fp, int crc, unsigned char *buf, unsigned buf_size, unsigned *low_addr, unsigned *high_addr,
+                  unsigned char *page_used, unsigned page_size)
 {
     int res, lcount, err;
     char line[1000];
@@ -81,7 +85,7 @@ int read_hex_file(FILE *fp, int crc, unsigned char *buf, unsigned buf_size, unsi
     {
         fgets(line, 1000, fp);
         lcount++;
-        if ((res = read_hex_line(line, buf, buf_size, low_addr, high_addr)) != NO_ERR)
+        if ((res = read_hex_line(line, buf, buf_size, low_addr, high_addr, page_used, page_size)) != NO_ERR)
         {
             switch(res)
             {
@@ -12,7 +12,8 @@
 #ifndef HEXFILE_H_
 #define HEXFILE_H_
 
-int read_hex_file(FILE *fp, int crc, unsigned char *buf, unsigned buf_size, unsigned *low_addr, unsigned *high_addr);
+int read_hex_file(FILE *fp, int crc, unsigned char *buf, unsigned buf_size, unsigned *low_addr, unsigned *high_addr,
+                  unsigned char *page_used, unsigned page_size);
 
 #define ERR_CRC  1
 #define ERR_ADDR 2
@@ -10,9 +10,13 @@
  *
  */
 
-#include "usb.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <getopt.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include "usbio.h"
 #include "hexfile.h"
 #include "flashprog.h"
 
@@ -20,37 +24,131 @@ const unsigned short VID_NORDIC     = 0x1915;
 const unsigned short PID_LU1BOOT    = 0x0101;
 
 static unsigned char hex_buf[MAX_FLASH_SIZE];
+static unsigned char page_used[MAX_FLASH_PAGES];     // Pages with any byte != 0xff in the hex file
 
-usb_dev_handle *find_and_open_usb(unsigned short vid, unsigned short pid)
+libusb_device_handle *find_and_open_usb(unsigned short vid, unsigned short pid)
 {
-    struct usb_bus *bus;
-    struct usb_device *dev;
-    usb_dev_handle *hdev;
+    libusb_device **devs;
+    struct libusb_device_descriptor desc;
+    libusb_device_handle *hdev;
+    ssize_t i, ndevs;
 
-    usb_find_busses();      // Find all USB busses on this system
-    usb_find_devices();     // Find all USB devices
+    ndevs = libusb_get_device_list(NULL, &devs);   // Find all USB devices
+    for(i = 0; i < ndevs; i++)
+    {
+        if(libusb_get_device_descriptor(devs[i], &desc) == 0 && desc.idVendor == vid && desc.idProduct == pid)
+        {
+            // Bootlader found. Open a connection to it:
+            if(libusb_open(devs[i], &hdev) < 0)
+                continue;
+            if(libusb_set_configuration(hdev, 1) < 0)
+            {
+                libusb_close(hdev);
+                continue;
+            }
+            if(libusb_claim_interface(hdev, 0) < 0)
+            {
+                libusb_close(hdev);
+                continue;
+            }
+            libusb_free_device_list(devs, 1);
+            return hdev;
+        }
+    }
+    if (ndevs >= 0)
+        libusb_free_device_list(devs, 1);
+    return 0;
+}
+
+static unsigned elapsed_ms(struct timeval *t0)
+{
+    struct timeval t;
+
+    gettimeofday(&t, NULL);
+    return (t.tv_sec - t0->tv_sec) * 1000 + (t.tv_usec - t0->tv_usec) / 1000;
+}
+
+// Where the bootloader is attached, and the matching devices that were there
+// before the reset, so wait_for_device() only accepts the new application:
+static unsigned char boot_bus;
+static unsigned char boot_ports[8];
+static int boot_nports;
+static unsigned char old_devs[16][2];                  // Bus and address
+static int num_old_devs;
+
+static int device_matches(libusb_device *dev, unsigned short vid, unsigned short pid)
+{
+    struct libusb_device_descriptor desc;
+
+    return libusb_get_device_descriptor(dev, &desc) == 0 && desc.idVendor == vid && desc.idProduct == pid;
+}
+
+static void note_devices(libusb_device_handle *hdev, unsigned short vid, unsigned short pid)
+{
+    libusb_device **devs;
+    libusb_device *dev = libusb_get_device(hdev);
+    ssize_t i, ndevs;
+
+    boot_bus = libusb_get_bus_number(dev);
+    boot_nports = libusb_get_port_numbers(dev, boot_ports, sizeof(boot_ports));
+    num_old_devs = 0;
+    ndevs = libusb_get_device_list(NULL, &devs);
+    for(i = 0; i < ndevs && num_old_devs < (int)(sizeof(old_devs) / sizeof(old_devs[0])); i++)
+    {
+        if(device_matches(devs[i], vid, pid))
+        {
+            old_devs[num_old_devs][0] = libusb_get_bus_number(devs[i]);
+            old_devs[num_old_devs][1] = libusb_get_device_address(devs[i]);
+            num_old_devs++;
+        }
+    }
+    if (ndevs >= 0)
+        libusb_free_device_list(devs, 1);
+}
+
+static int is_new_device(libusb_device *dev)
+{
+    unsigned char ports[8];
+    int i, n;
+
+    // The application comes up where the bootloader was. Without port
+    // numbers from libusb the bus has to do:
+    if (libusb_get_bus_number(dev) != boot_bus)
+        return 0;
+    if (boot_nports > 0)
+    {
+        n = libusb_get_port_numbers(dev, ports, sizeof(ports));
+        if (n != boot_nports || memcmp(ports, boot_ports, n) != 0)
+            return 0;
+    }
+    for(i = 0; i < num_old_devs; i++)
+    {
+        if (old_devs[i][0] == boot_bus && old_devs[i][1] == libusb_get_device_address(dev))
+            return 0;
+    }
+    return 1;
+}
+
+static int wait_for_device(unsigned short vid, unsigned short pid, struct timeval *t0, unsigned timeout_ms)
+{
+    libusb_device **devs;
+    ssize_t i, ndevs;
 
-    for(bus = usb_busses; bus; bus = bus->next) 
+    // Poll the device list until the application has enumerated:
+    while (elapsed_ms(t0) < timeout_ms)
     {
-        for(dev = bus->devices; dev; dev = dev->next) 
+        ndevs = libusb_get_device_list(NULL, &devs);
+        for(i = 0; i < ndevs; i++)
         {
-            if(dev->descriptor.idVendor == vid && dev->descriptor.idProduct == pid)
+            if(device_matches(devs[i], vid, pid) && is_new_device(devs[i]))
             {
-                // Bootlader found. Open a connection to it:
-                hdev = usb_open(dev);
-                if(usb_set_configuration(hdev, 1) < 0)
-                {
-                    usb_close(hdev);
-                    continue;
-                }
-                if(usb_claim_interface(hdev, 0) < 0)
-                {
-                    usb_close(hdev);
-                    continue;
-                }
-                return hdev;
+                libusb_free_device_list(devs, 1);
+                return 1;
             }
         }
+        if (ndevs >= 0)
+            libusb_free_device_list(devs, 1);
+        usleep(10000);
     }
     return 0;
 }
@@ -59,20 +157,28 @@ void print_usage(void)
 {
     fprintf(stderr, "bootlu1p Modified by Mo10 v0.1\n");
     fprintf(stderr, "usage: bootlu1p [options] <hex-file>\n");
+    fprintf(stderr, "       bootlu1p -e [options]\n");
     fprintf(stderr, "       options:\n");
     fprintf(stderr, "       -r Reset after programming\n");
+    fprintf(stderr, "       -w vid:pid Reset, then wait for the application's USB device (hex ids)\n");
+    fprintf(stderr, "       -d Only program pages that differ from the flash contents\n");
+    fprintf(stderr, "       -e Erase the application pages only, no hex-file\n");
+    fprintf(stderr, "       -v Read all programmed pages back to verify them\n");
     fprintf(stderr, "       -f 16 Flash size is 16K Bytes\n");
     fprintf(stderr, "       -f 32 Flash size is 32K Bytes\n");
+    fprintf(stderr, "          Only needed if the bootloader does not report it\n");
 }
 
 int main(int argc, char* argv[])
 {   
     char c;
-    unsigned flash_size, i, low_addr = 0, high_addr = 0, auto_reset = 0;
+    unsigned flash_size = 0, i, low_addr = 0, high_addr = 0, auto_reset = 0, erase_only = 0, options = 0;
+    unsigned short app_vid = 0, app_pid = 0;
+    struct timeval t0;
     FILE *fp;
-    usb_dev_handle *hdev;
+    libusb_device_handle *hdev;
 
-    while((c = getopt(argc, argv, "rf:")) != EOF)
+    while((c = getopt(argc, argv, "rdevf:w:")) != EOF)
     {
         switch(c)
         {
@@ -88,44 +194,97 @@ int main(int argc, char* argv[])
         case 'r':
             auto_reset = 1;
             break;
+        case 'w':
+            if (sscanf(optarg, "%hx:%hx", &app_vid, &app_pid) != 2)
+            {
+                print_usage();
+                exit(EXIT_FAILURE);
+            }
+            auto_reset = 1;
+            break;
+        case 'd':
+            options |= PROG_DIFFERENTIAL;
+            break;
+        case 'e':
+            erase_only = 1;
+            break;
+        case 'v':
+            options |= PROG_VERIFY;
+            break;
         default:
             print_usage();
             exit(EXIT_FAILURE);
         }
     }
-    if ((argc - optind) != 1)
+    if ((argc - optind) != (erase_only ? 0 : 1))
     {
         print_usage();
         exit(EXIT_FAILURE);
     }
 
-    if ((fp = fopen(argv[optind], "rt")) == 0)
+    if (!erase_only && (fp = fopen(argv[optind], "rt")) == 0)
     {
         fprintf(stderr, "ERROR: Can't open input file <%s>\n", argv[optind]);
         return 1;
     }    
-    usb_init();             // Initialize libusb
+    if (libusb_init(NULL) < 0)
+    {
+        fprintf(stderr, "ERROR: Can't initialize libusb\n");
+        exit(EXIT_FAILURE);
+    }
     hdev = find_and_open_usb(VID_NORDIC, PID_LU1BOOT);
     if (hdev == 0)
     {
         fprintf(stderr, "ERROR: nRF24LU1P Bootloader not found\n");
         exit(EXIT_FAILURE);
     }
-    for(i=0;i<flash_size;i++)
-        hex_buf[i] = 0xff;
-    if (read_hex_file(fp, 1, hex_buf, flash_size, &low_addr, &high_addr) != NO_ERR)
+    if (!bootl_init(hdev, &flash_size))
     {
         exit(EXIT_FAILURE);
     }
-    if (!flash_prog(hdev, low_addr, high_addr, flash_size, hex_buf))
+    if (erase_only)
     {
-        fprintf(stderr, "ERROR: There was an error programming the flash\n");
-        exit(EXIT_FAILURE);
+        if (!flash_erase(hdev))
+        {
+            fprintf(stderr, "ERROR: There was an error erasing the flash\n");
+            exit(EXIT_FAILURE);
+        }
     }
+    else
+    {
+        for(i=0;i<flash_size;i++)
+            hex_buf[i] = 0xff;
+        if (read_hex_file(fp, 1, hex_buf, flash_size, &low_addr, &high_addr, page_used, FLASH_PAGE_SIZE) != NO_ERR)
+        {
+            exit(EXIT_FAILURE);
+        }
+        if (!flash_prog(hdev, low_addr, high_addr, flash_size, hex_buf, page_used, options))
+        {
+            fprintf(stderr, "ERROR: There was an error programming the flash\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (app_vid != 0 || app_pid != 0)
+    {
+        note_devices(hdev, app_vid, app_pid);
+    }
+    gettimeofday(&t0, NULL);
     if (auto_reset)
     {
     	reset_bootl(hdev);
     }
-    usb_close(hdev);
+    libusb_release_interface(hdev, 0);
+    libusb_close(hdev);
+    if (app_vid != 0 || app_pid != 0)
+    {
+        if (!wait_for_device(app_vid, app_pid, &t0, 10000))
+        {
+            fprintf(stderr, "ERROR: Application %04x:%04x did not enumerate\n", app_vid, app_pid);
+            libusb_exit(NULL);
+            exit(EXIT_FAILURE);
+        }
+        fprintf(stdout, "Application ready %u ms after programming\n", elapsed_ms(&t0));
+    }
+    libusb_exit(NULL);
     exit(EXIT_SUCCESS);
 }
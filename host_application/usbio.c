@@ -0,0 +1,104 @@
+/* Copyright (c) 2009 Nordic Semiconductor. All Rights Reserved.
+ *
+ * The information contained herein is confidential property of Nordic 
+ * Semiconductor ASA. Terms and conditions of usage are described in detail 
+ * in NORDIC SEMICONDUCTOR STANDARD SOFTWARE LICENSE AGREEMENT. 
+ *
+ * Licensees are granted free, non-transferable use of the information. NO
+ * WARRENTY of ANY KIND is provided. This heading must NOT be removed from
+ * the file.
+ *
+ */
+#include <stddef.h>
+#include "usbio.h"
+
+typedef struct
+{
+    struct libusb_transfer *transfer;
+    int completed;
+} usbio_slot_t;
+
+static usbio_slot_t slots[USBIO_MAX_TRANSFERS];
+
+static void LIBUSB_CALL transfer_done(struct libusb_transfer *transfer)
+{
+    *(int *)transfer->user_data = 1;
+}
+
+int usbio_submit(libusb_device_handle *hdev, unsigned char ep, unsigned char *buf, int len, unsigned timeout)
+{
+    int id, res;
+
+    for (id = 0; id < USBIO_MAX_TRANSFERS && slots[id].transfer != NULL; id++)
+        ;
+    if (id == USBIO_MAX_TRANSFERS)
+        return LIBUSB_ERROR_BUSY;
+    if ((slots[id].transfer = libusb_alloc_transfer(0)) == NULL)
+        return LIBUSB_ERROR_NO_MEM;
+    slots[id].completed = 0;
+    libusb_fill_bulk_transfer(slots[id].transfer, hdev, ep, buf, len, transfer_done, &slots[id].completed, timeout);
+    if ((res = libusb_submit_transfer(slots[id].transfer)) < 0)
+    {
+        libusb_free_transfer(slots[id].transfer);
+        slots[id].transfer = NULL;
+        return res;
+    }
+    return id;
+}
+
+int usbio_wait(int id)
+{
+    usbio_slot_t *slot;
+    int res;
+
+    if (id < 0)
+        return id;
+    slot = &slots[id];
+    while (!slot->completed)
+    {
+        res = libusb_handle_events_completed(NULL, &slot->completed);
+        if (res < 0 && res != LIBUSB_ERROR_INTERRUPTED)
+            return res;
+    }
+    switch (slot->transfer->status)
+    {
+        case LIBUSB_TRANSFER_COMPLETED:
+            res = slot->transfer->actual_length;
+            break;
+        case LIBUSB_TRANSFER_TIMED_OUT:
+            res = LIBUSB_ERROR_TIMEOUT;
+            break;
+        case LIBUSB_TRANSFER_STALL:
+            res = LIBUSB_ERROR_PIPE;
+            break;
+        case LIBUSB_TRANSFER_NO_DEVICE:
+            res = LIBUSB_ERROR_NO_DEVICE;
+            break;
+        case LIBUSB_TRANSFER_OVERFLOW:
+            res = LIBUSB_ERROR_OVERFLOW;
+            break;
+        default:
+            res = LIBUSB_ERROR_IO;
+            break;
+    }
+    libusb_free_transfer(slot->transfer);
+    slot->transfer = NULL;
+    return res;
+}
+
+int usbio_wait_all(void)
+{
+    int id, res, err = 0;
+
+    for (id = 0; id < USBIO_MAX_TRANSFERS; id++)
+    {
+        if (slots[id].transfer != NULL && (res = usbio_wait(id)) < 0)
+            err = res;
+    }
+    return err;
+}
+
+int usbio_bulk(libusb_device_handle *hdev, unsigned char ep, unsigned char *buf, int len, unsigned timeout)
+{
+    return usbio_wait(usbio_submit(hdev, ep, buf, len, timeout));
+}
@@ -0,0 +1,38 @@
+/* Copyright (c) 2009 Nordic Semiconductor. All Rights Reserved.
+ *
+ * The information contained herein is confidential property of Nordic 
+ * Semiconductor ASA. Terms and conditions of usage are described in detail 
+ * in NORDIC SEMICONDUCTOR STANDARD SOFTWARE LICENSE AGREEMENT. 
+ *
+ * Licensees are granted free, non-transferable use of the information. NO
+ * WARRENTY of ANY KIND is provided. This heading must NOT be removed from
+ * the file.
+ *
+ */
+#ifndef USBIO_H_
+#define USBIO_H_
+
+#include <libusb.h>
+
+#define USBIO_MAX_TRANSFERS 32      // Bulk transfers that can be in flight at the same time
+
+/** Queue a bulk transfer, the direction is given by the endpoint address
+ *  @return transfer id for usbio_wait(), or a negative libusb error code
+ */
+int usbio_submit(libusb_device_handle *hdev, unsigned char ep, unsigned char *buf, int len, unsigned timeout);
+
+/** Run the libusb event loop until a queued transfer is done and release it
+ *  @return number of bytes transferred, or a negative libusb error code
+ */
+int usbio_wait(int id);
+
+/** Wait for all queued transfers
+ *  @return 0, or the last negative libusb error code
+ */
+int usbio_wait_all(void);
+
+/** Blocking bulk transfer, the same as usbio_submit() followed by usbio_wait()
+ */
+int usbio_bulk(libusb_device_handle *hdev, unsigned char ep, unsigned char *buf, int len, unsigned timeout);
+
+#endif // USBIO_H_